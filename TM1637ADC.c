@@ -3,20 +3,29 @@
 // Microchip 12F675/TM1637 ADC and display code written/adapted by Steve Williams
 // for Microchip's MPLAB XC8 compiler. The TM1637 display routines were originally
 // written by electro-dan for the BoostC compiler as part of project, the ADC
-// related coding was written by me.
+// related coding was written by me. The TM1637 driver is in tm1637.c, this image is
+// configured by config/TM1637ADC/tm1637config.h which must be on the project include path.
 // See also: https://github.com/electro-dan/PIC12F_TM1637_Thermometer
 // The code reads a single ADC channel AN0(pin7) and could be adapted to read more
 // The main ADC read loop is non-blocking though the TM1637 display writes are not
-// The ADC is read at 1 second intervals. The code leaves it turned on, not power optimised
+// The ADC is read at 1 second intervals, or with the alarm enabled every 100ms with 10 samples
+// averaged for display. The code leaves it turned on, not power optimised
 // Rounding adds significant overhead, could save program memory by removing if needed
+// Optional two point calibration: hold GP3 low for 1s at reset, apply CALLOWmV then CALHIGHmV
+// to AN0 pressing GP3 to capture each point. Gain/offset are stored in data EEPROM.
+// Optional telemetry: a Timer0 driven, transmit only software UART on GP1 sends a binary
+// frame with each reading and the driver counters, bytes are queued and sent by the ISR.
+// Optional alarm: each 100ms sample is checked against high/low thresholds with hysteresis,
+// a tripped alarm blinks the display and holds the GP2 LED on as the alarm output.
 // 
 // No warranty is implied and the code is for test use at users own risk. 
 // 
 // Hardware configuration for the PIC 12F675:
 // GP0 = ADC input (pin 7)
-// GP1 = OUT: N/C
-// GP2 = in original code IN/OUT for DS18B20 (not used by this demo)
-// GP3 = OUT: N/C
+// GP1 = OUT: UART TX if UARTTELEMETRY set, or IN: external ADC VREF if ADCVREFEXTERNAL set
+// GP2 = OUT: LED, also alarm output if ALARMENABLE set, in original code IN/OUT for DS18B20
+// GP3 = IN: N/C, or calibration push button if ADCCALIBRATION set, active low, needs external
+//       pullup (input only pin)
 // GP4 = IN/OUT: TM1637 DIO
 // GP5 = IN/OUT: TM1637 CLK
 // -----------------------------------------------------------------------
@@ -33,15 +42,12 @@
 #pragma config CP = OFF         // Code Protection bit (Program Memory code protection is disabled)
 #pragma config CPD = OFF        // Data Code Protection bit (Data memory code protection is disabled)
 
-#define _XTAL_FREQ 4000000      // Define clock frequency used by xc8 __delay(time) functions
+#include "tm1637.h"             // TM1637 driver, pins and display variables, includes tm1637config.h
+                                // which sets _XTAL_FREQ for the xc8 __delay(time) functions
 
-// Set the TM1637 module data and clock pins:
-#define trisConfiguration 0b00110000; // TM1637 GP4/5 pins are inputs, TM1637 module pullups 
-                                      // will take these high. Configuration here of display pins ONLY 
-#define tm1637dio GP4                 // Set the i/o ports names for TM1637 data and clock here
-#define tm1637dioTrisBit 4            // This is the bit shift to set TRIS for GP4
-#define tm1637clk GP5
-#define tm1637clkTrisBit 5
+#if !TM1637_DECIMALPOINT || !TM1637_DIGITLIMIT
+#error "TM1637ADC.c needs TM1637_DECIMALPOINT and TM1637_DIGITLIMIT set to 1 in tm1637config.h"
+#endif
 
 //Timer1 definitions:
 #define T1PRESCALE 01                  // 2 bits control, 01 = 1:2
@@ -53,7 +59,8 @@
 
 //General global variables:
 volatile uint8_t timer1Flag = 0;               // Flag is set by Timer 1 ISR every 100ms
-uint8_t ADCreadcounter = 0;                    // Counts intervals for ADC task in 100ms increments
+uint8_t ADCreadcounter = 0;                    // Counts intervals for ADC task in 100ms increments, or
+                                               // with the alarm the sub-samples taken for next display update
 uint8_t ADCreadStatus = 0;                     // Stage of ADC conversion task, 0 = not started
 uint8_t LEDcounter = 0;                        // Used to time non-blocking LED flash in 100ms increments
 uint8_t LEDonTime = 0;                         // If true LED flash routine is called, flashes N x 100ms 
@@ -62,50 +69,120 @@ uint8_t LEDonTime = 0;                         // If true LED flash routine is c
 #define NOCONVERSION 0
 #define STARTADCREAD 1
 #define CONVERTING 2
+#define ADCGAINFRACBITS 3              // Gain is full scale Vin in mV x 8 (Q3), so max full scale 8191mV
+#define ADCSUBSAMPLES 10               // With alarm, samples taken at 100ms intervals and averaged per display
+
+//ADC calibration and reference options:
+#define ADCCALIBRATION 0               // If set 1 enables calibration mode, entered by holding GP3 low at reset
+                                       // Needs a GP3 pullup as the 12F675 has no weak pullup on GP3
+#define ADCVREFEXTERNAL 0              // If set 1 ADC uses VREF on GP1 (VCFG) instead of VDD, set RefmV to match
+#define CALLOWmV 500                   // Known reference voltages applied to AN0 during calibration, in mV
+#define CALHIGHmV 4500
+#define CALSAMPLES 8                   // Samples summed at each calibration point, 8 gives Q3 raw ADC value
+#define CALEEPROMADDR 0                // Data EEPROM address of stored gain/offset, 5 bytes used
+#define CALVALIDMARKER 0xA5            // Written after gain/offset, marks EEPROM calibration data as valid
+#define calButton GP3                  // Calibration push button, reads 0 when pressed
+
+//Software UART telemetry definitions, 2400 baud 8N1, TX only:
+#define UARTTELEMETRY 0                // If set 1 enables the UART telemetry stream on GP1, off by default
+                                       // until the XC8 program memory use has been checked, see README
+#define uartTxPin GP1                  // Nb. GP3 is input only on the 12F675 so cannot be used for TX
+#define UARTTMR0RELOAD 49              // Timer0 @ 1:2 prescale, 208 x 2us = 416us bit. Added to running
+                                       // count, +1 corrects for prescaler clear when TMR0 is written
+#define UARTBUFFERSIZE 8               // Transmit queue size, must be a power of 2, all 8 slots usable so
+                                       // one complete frame always fits in an empty queue
+#define UARTBUFFERMASK (UARTBUFFERSIZE - 1)
+#define UARTFRAMESYNC 0xA5             // First byte of each telemetry frame
+#if UARTTELEMETRY && ADCVREFEXTERNAL
+#error "UART telemetry and external VREF both use GP1"
+#endif
+#if UARTTELEMETRY && !TM1637_ACKCHECK
+#error "UART telemetry needs TM1637_ACKCHECK set to 1 in tm1637config.h for the NACK count"
+#endif
+
+//Alarm definitions:
+#define ALARMENABLE 0                  // If set 1 enables the threshold alarm, off by default until the
+                                       // XC8 program memory use has been checked, see README
+#define alarmPin GP2                   // Alarm output, shared with the LED which is held on in alarm
+#define ALARMTRIPTICKS 3               // Threshold must be exceeded for N x 100ms Timer1 ticks to trip
+#define ALARMBLINKTICKS 3              // Display on/off toggled every N x 100ms while in alarm
 
 //ADC variables:
-const uint16_t RefmV = 5000;          // Specify Vref in mV
+const uint16_t RefmV = 5000;          // Specify Vref in mV, nominal value used if not calibrated
 const uint8_t ADCinputConfig = 0x01;  // Setting bit 0..3 enables ADC inputs 0..3, used to set TRISIO and ANSEL
 const uint8_t ADCchannel = 0;         // Active ADC channel, AN0 = 0..AN3 = 3
-
-//Display variables:
-const uint8_t tm1637ByteSetData = 0x40;        // 0x40 [01000000] = Indicate command to display data
-const uint8_t tm1637ByteSetAddr = 0xC0;        // 0xC0 [11000000] = Start address write out all display bytes 
-const uint8_t tm1637ByteSetOn = 0x88;          // 0x88 [10001000] = Display ON, plus brightness
-const uint8_t tm1637ByteSetOff = 0x80;         // 0x80 [10000000] = Display OFF 
-const uint8_t tm1637MaxDigits = 4;
-const uint8_t tm1637RightDigit = tm1637MaxDigits - 1;
-// Used to output the segment data for numbers 0..9 :
-const uint8_t tm1637DisplayNumtoSeg[] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
-uint8_t tm1637Brightness = 5;         // Range 0 to 7
-uint8_t tm1637Data[] = {0, 0, 0, 0};  // Digit numeric data to display,array elements are for digits 0..3
-uint8_t decimalPointPos = 99;         // Flag for decimal point (digits counted from left),if > MaxDigits dp off
-uint8_t zeroBlanking = 0;             // If set true blanks leading zeros
-uint8_t numDisplayedDigits = 3;       // Limits total displayed digits, used after rounding a decimal value
+uint16_t ADCgain = 0;                 // Full scale mV in Q3, set from RefmV or calibration by initialise()
+int16_t ADCoffset = 0;                // Offset correction in mV, added after gain scaling
+
+//UART and profiling variables:
+#if UARTTELEMETRY
+uint8_t uartBuffer[UARTBUFFERSIZE];   // Transmit queue, written by uartQueueByte(), read by ISR
+volatile uint8_t uartHead = 0;        // Count of bytes queued, free running, masked to index the queue
+volatile uint8_t uartTail = 0;        // Count of bytes taken by the ISR, head - tail = bytes in queue
+uint8_t uartTxByte = 0;               // Byte being shifted out, used by ISR only
+uint8_t uartBitCount = 0;             // Bits left to send: 9..2 data, 1 stop, 0 = idle/start next
+uint8_t uartDropCount = 0;            // Bytes dropped because the queue was full
+uint16_t loopCount = 0;               // Main loop passes since last frame, a measure of spare CPU time
+#endif
+
+//Alarm variables:
+#if ALARMENABLE
+const uint16_t alarmHighmV = 4500;    // Alarm trips above this value
+const uint16_t alarmLowmV = 500;      // Alarm trips below this value, must be at least 1
+const uint16_t alarmHysteresismV = 50; // Alarm clears only when back inside thresholds by this margin
+uint16_t alarmHighQ3 = 0;             // Thresholds as Q3 raw ADC values, set by alarmSetLimits() so
+uint16_t alarmLowQ3 = 0;              // samples are checked without converting to mV
+uint16_t alarmClearHighQ3 = 0;
+uint16_t alarmClearLowQ3 = 0;
+uint8_t alarmCondition = 0;           // Set if latest sample is outside thresholds
+uint8_t alarmActive = 0;              // Set once condition has persisted ALARMTRIPTICKS
+uint8_t alarmTripCounter = 0;         // Counts Timer1 ticks with alarm condition present
+uint8_t alarmBlinkCounter = 0;        // Counts Timer1 ticks between display on/off toggles
+uint8_t alarmDisplayOff = 0;          // Set while display is blanked by alarm blinking
+#endif
 
 // ISR Handles Timer1 interrupt:
 void __interrupt() ISR(void);  // Note XC8 interrupt function setup syntax using __interrupt() + myisr()
 void initialise(void);
 void LEDflash(void);
-uint16_t readADC(void);        // Returns ADC Vin in mV, ie 5000 max if Vref if Vref = 5V
-void tm1637StartCondition(void);
-void tm1637StopCondition(void);
-uint8_t tm1637ByteWrite(uint8_t bWrite);
-void tm1637UpdateDisplay(void);
-void tm1637DisplayOn(void);
-void tm1637DisplayOff(void);
-uint8_t getDigits(unsigned int number);   //Extracts decimal digits from integer, populates tm1637Data array
+uint16_t readADCraw(void);     // Returns the raw 10 bit ADC result
+uint16_t ADCtomV(uint16_t ADCvalQ3);   // Applies gain/offset to a Q3 (x8) raw ADC value, returns mV
+void calibrateADC(void);
+uint16_t calCapturePoint(void);
+void calFail(void);
 void roundDigits(void);
+void uartQueueByte(uint8_t txByte);
+void uartSendFrame(uint16_t mV);
+void alarmSetLimits(void);
+uint16_t alarmmVtoQ3(uint16_t mV);
+void alarmCheck(uint16_t ADCvalQ3);
+void alarmTick(void);
 
 
 void main(void)
 {
   uint16_t displayedInt=0;       // Beware 65K limit if larger than 4 digit display,consider using uint32_t
+#if ALARMENABLE
+  uint16_t ADCsum = 0;           // Sum of raw sub-samples, max 10 x 1023 so fits 16 bits
+  uint16_t ADCval = 0;
+#endif
   uint16_t ctr = 0;
   _delay(100);
   initialise();
+#if TM1637_ZEROBLANKING
   zeroBlanking = 0;              // Don't blank leading zeros
+#endif
   decimalPointPos = 0;           // Display 0-5000mV as n.nnn volts, digit 0 = leftmost
+  numDisplayedDigits = 3;        // Display rounded to 3 digits, n.nn volts
+#if ADCCALIBRATION
+  for (ctr = 0; ctr < 100 && !calButton; ctr++)
+      __delay_ms(10);            // Button must be held low for 1s at reset, a glitch or floating
+  if (ctr >= 100)                // pin won't enter the blocking calibration mode
+      calibrateADC();
+#endif
+#if ALARMENABLE
+  alarmSetLimits();              // After calibration, limits depend on gain and offset
+#endif
   getDigits(displayedInt);
   tm1637UpdateDisplay();         // Display zero then start timed conversions, updating display as completed
   ADCreadcounter = 0;            // Start with timing counts at zero, both ADC read and timer1 flags
@@ -113,18 +190,28 @@ void main(void)
   T1CON |= TIMER1ON;
   while(1)
     {
+#if UARTTELEMETRY
+      if (loopCount != 0xFFFF)                   // Count loop passes, saturating
+          loopCount ++;
+#endif
       if (timer1Flag)
         {
-           ADCreadcounter ++;                    // Update task interval and LED timing flags
-           LEDcounter ++;                           
+           LEDcounter ++;                        // Update LED timing
+#if ALARMENABLE
+           ADCreadStatus = STARTADCREAD;         // Start ADC read process every 100 ms for alarm checks
+           alarmTick();                          // Alarm trip delay and blink timing
+#else
+           ADCreadcounter ++;                    // Update task interval
+#endif
            timer1Flag = 0;                       // Clear the 100ms timing flag
         }
-      
-      if (ADCreadcounter >= 10)                  // Start ADC read process every 100 ms
+#if !ALARMENABLE
+      if (ADCreadcounter >= 10)                  // Start ADC read process every 1 s
         { 
            ADCreadcounter = 0;
            ADCreadStatus = STARTADCREAD;         // Setting to 1 = start of ADC read 
         }
+#endif
       
       switch (ADCreadStatus)             // The ADC read/display task is managed by ADCreadStatus control flag
       {
@@ -133,22 +220,48 @@ void main(void)
               case STARTADCREAD:                 // nb. must only start ADC conversions after Taq since last
                   ADCON0 |= 0x02;                // Set GO/DONE, bit 1, to start conversion
                   ADCreadStatus = CONVERTING;
-                  LEDcounter = 0;                // Zero the LED time counter, note counts 100ms increments
-                  LEDonTime = 1;                 // Sets up a 500ms LED flash
                   break;
               case CONVERTING:                   // Polls GO/DONE for completed conversion,COULD ADD TIMEOUT?
-                  if (!(ADCON0 & 0x20))
+                  if (!(ADCON0 & 0x02))
                   {
-                      displayedInt = readADC();  // Get the ADC data and convert to integer, Vin in mV
-                      getDigits(displayedInt);   // Extract digit data from integer into 4x uint8_t array 
-                      roundDigits();             // Apply rounding to the array data if <4 digits displayed
-                      tm1637UpdateDisplay();
                       ADCreadStatus = NOCONVERSION;  // Consider adding a timed delay before reset this flag
+#if ALARMENABLE
+                      ADCval = readADCraw();
+                      alarmCheck(ADCval << 3);   // Every sub-sample is checked against alarm limits
+                      ADCsum += ADCval;
+                      ADCreadcounter ++;
+                      if (ADCreadcounter >= ADCSUBSAMPLES)
+                      {
+                          // Average as Q3 value for conversion: sum x 8 / 10 = sum x 4 / 5, fits 16 bits
+                          displayedInt = ADCtomV((ADCsum << 2) / 5);
+                          ADCsum = 0;
+                          ADCreadcounter = 0;
+#else
+                      {
+                          displayedInt = ADCtomV(readADCraw() << 3);  // Vin in mV, raw x 8 is the Q3 value
+#endif
+                          getDigits(displayedInt);   // Extract digit data from integer into 4x uint8_t array 
+                          roundDigits();             // Apply rounding to the array data if <4 digits displayed
+                          tm1637UpdateDisplay();
+#if ALARMENABLE
+                          if (alarmDisplayOff)       // Update turns the display on, blank again if in the
+                              tm1637DisplayOff();    // off phase of the blink so its timing is unchanged
+#endif
+#if UARTTELEMETRY
+                          uartSendFrame(displayedInt);
+#endif
+                          LEDcounter = 0;            // Zero the LED time counter, note counts 100ms increments
+                          LEDonTime = 1;             // Sets up a 100ms LED flash
+                      }
                   }
                   break;
       }
              
+#if ALARMENABLE
+      if (LEDonTime && !alarmActive)              // Alarm holds the LED on so no flash while active
+#else
       if (LEDonTime)                              // Call the LED flash function if a count is set
+#endif
           LEDflash();   
     }                       //while(1)
 }                           //main
@@ -171,6 +284,33 @@ void ISR(void)
         timer1Flag = 1;               
         
     }
+#if UARTTELEMETRY
+    if ((INTCON & 0x24) == 0x24)      // Check Timer0 interrupt flag bit 2 and enable bit 5 are set
+    {
+        INTCON &= 0xFB;               // Clear interrupt flag bit 2
+        TMR0 += UARTTMR0RELOAD;       // Add preload to running count, corrects for interrupt latency
+        if (uartBitCount > 1)         // Data bits, sent LSB first
+        {
+            uartTxPin = uartTxByte & 0x01;
+            uartTxByte >>= 1;
+            uartBitCount --;
+        }
+        else if (uartBitCount == 1)   // Stop bit
+        {
+            uartTxPin = 1;
+            uartBitCount = 0;
+        }
+        else if (uartHead != uartTail)  // Stop bit done, start the next queued byte
+        {
+            uartTxByte = uartBuffer[uartTail & UARTBUFFERMASK];
+            uartTail ++;
+            uartTxPin = 0;            // Start bit
+            uartBitCount = 9;
+        }
+        else
+            INTCON &= 0xDF;           // Queue empty, Timer0 interrupt off until next byte queued
+    }
+#endif
 }
 
 //*******************************************************************************************
@@ -191,176 +331,131 @@ void LEDflash(void)
 }
 
 //********************************************************************************************
-// readADC() reads the 10 bit ratiometric ADCvalue (Vin/Vref). Integer arithmetic is used 
-// for conversion to a 32 bit unsigned integer value which is Vin in mV.Note XC8 integers
-// are limited to 32 bit. This method suitable for 10 bit ADC conversions only and gives 
-// minimal loss of resolution given that we get 5mV per bit @ 5V Vref.
+// readADCraw() returns the 10 bit ratiometric ADC value (Vin/Vref) from ADRESH:ADRESL.
+// ADCtomV() converts it to Vin in mV.
 //********************************************************************************************
 
-uint16_t readADC(void)                  // Returns a 16 bit unsigned integer, Vin in mV
+uint16_t readADCraw(void)
 {
-    uint32_t ADCmVfractional = 0;       // ADC -> mV calculation will require 32 bit integer arithmetic
     uint16_t ADCval = ADRESL;           // ADC result is a 10 bit number, read lower 8 bits
     ADCval |= (uint16_t)ADRESH << 8;    // Get bits 8/9 of the result,storing as as 16 bit integer
-    uint32_t ADCmV = (uint32_t)RefmV * (uint32_t)ADCval; // nb need a 32 bit value RHS to get 32bit arithmetic
-    ADCmVfractional = ADCmV & 0x000003FF;                // Store the lower 16 bit binary part before division
-    ADCmV >>= 10;                       // Divide by 1024, result is the whole mV part of conversion
-    // The binary rounding here is optional, uses code space and adds limited additional accuracy:
-    if (ADCmVfractional>0x200)    // Next look at the fractional binary part, round up if >0.5 mV
-      ADCmV += 1;                 
-    return((uint16_t)ADCmV);      // OK to cast result to 16 bit as value is less than 2^16(65536)  
+    return(ADCval);
 }
 
+//********************************************************************************************
+// ADCtomV() converts a Q3 raw ADC value (10 bit value x 8, or a sum of 8 samples) to mV.
+// Vref and the calibration gain are combined in ADCgain, full scale mV x 8, so the 
+// conversion is one multiply: mV = ADCgain * ADCvalQ3 / 65536, the divide being just the
+// upper 16 bits of the product. Both operands are 16 bit but XC8 widens them to 32 bit,
+// so this is the same 32 x 32 bit library multiply as the original Vref * ADC code. Since
+// ADCgain = Vref mV x 8 and ADCvalQ3 = ADC x 8, uncalibrated this is Vref * ADC / 1024 as
+// before. Offset is then added as a 16 bit value.
+//********************************************************************************************
 
-/*********************************************************************************************
- tm1637UpdateDisplay()
- Publish the tm1637Data array to the display
-*********************************************************************************************/
-void tm1637UpdateDisplay()
-{   
-    uint8_t tm1637DigitSegs = 0;
-    uint8_t ctr;
-    uint8_t stopBlanking = !zeroBlanking;            // Allow blanking of leading zeros if flag set
-            
-    // Write 0x40 [01000000] to indicate command to display data - [Write data to display register]:
-    tm1637StartCondition();
-    tm1637ByteWrite(tm1637ByteSetData);
-    tm1637StopCondition();
-
-    // Specify the display address 0xC0 [11000000] then write out all 4 bytes:
-    tm1637StartCondition();
-    tm1637ByteWrite(tm1637ByteSetAddr);
-    for (ctr = 0; ctr < tm1637MaxDigits; ctr ++)
-    {
-        tm1637DigitSegs = tm1637DisplayNumtoSeg[tm1637Data[ctr]];
-        if (!stopBlanking && (tm1637Data[ctr]==0))  // Blank leading zeros if stop blanking flag not set
-            {
-               if (ctr < tm1637RightDigit)          // Never blank the rightmost digit
-                  tm1637DigitSegs = 0;              // Segments set 0x00 gives blanked display numeral
-            }
-        else
-        {
-           stopBlanking = 1;                    // Stop blanking if have reached a non-zero digit
-           if (ctr==decimalPointPos)            // Flag for presence of decimal point, digits 0..3
-           {                                    // No dp display if decimalPointPos is set > Maxdigits
-               tm1637DigitSegs |= 0b10000000;   // High bit of segment data is decimal point, set to display
-           }
-        }
-        if (ctr>(numDisplayedDigits-1))
-            tm1637DigitSegs = 0;             // Segments set 0x00 blanks,limits displayed digits left to right
-        
-        tm1637ByteWrite(tm1637DigitSegs);       // Finally write out the segment data for each digit
-    }
-    tm1637StopCondition();
-
-    // Write 0x80 [10001000] - Display ON, plus brightness
-    tm1637StartCondition();
-    tm1637ByteWrite((tm1637ByteSetOn + tm1637Brightness));
-    tm1637StopCondition();
-}
-
-
-/*********************************************************************************************
- tm1637DisplayOn()
- Send display on command
-*********************************************************************************************/
-void tm1637DisplayOn(void)
+uint16_t ADCtomV(uint16_t ADCvalQ3)
 {
-    tm1637StartCondition();
-    tm1637ByteWrite((tm1637ByteSetOn + tm1637Brightness));
-    tm1637StopCondition();
+    uint32_t ADCmV = (uint32_t)ADCgain * ADCvalQ3;     // nb need a 32 bit value RHS to get 32bit arithmetic
+    // The binary rounding here is optional, adding 0x8000 rounds up if fractional part >0.5 mV:
+    ADCmV += 0x8000;
+    int16_t mV = (int16_t)(ADCmV >> 16); // Max 8191 mV so safe to use a signed 16 bit value
+    mV += ADCoffset;
+    if (mV < 0)                          // Negative offset can take a near zero reading below 0
+        mV = 0;
+    return((uint16_t)mV);
 }
 
+//********************************************************************************************
+// calibrateADC() is a blocking routine entered if GP3 is held low at reset. The operator
+// applies CALLOWmV to AN0 (LED on) and presses GP3, then applies CALHIGHmV (LED off) and
+// presses GP3 again. The display shows the current reading throughout. Gain and offset are
+// calculated from the two points and saved to data EEPROM, the 32 bit divide here is only
+// done once. If the points are unusable calFail() signals the error and the previous 
+// gain/offset are kept.
+//********************************************************************************************
 
-/*********************************************************************************************
- tm1637DisplayOff()
- Send display off command
-*********************************************************************************************/
-void tm1637DisplayOff(void)
-{
-    tm1637StartCondition();
-    tm1637ByteWrite(tm1637ByteSetOff);
-    tm1637StopCondition();
-}
-
-/*********************************************************************************************
- tm1637StartCondition()
- Send the start condition
-*********************************************************************************************/
-void tm1637StartCondition(void) 
+#if ADCCALIBRATION
+void calibrateADC(void)
 {
-    TRISIO &= ~(1<<tm1637dioTrisBit);  //Clear data tris bit
-    tm1637dio = 0;                     //Data output set low
-    __delay_us(100);
+    uint16_t calLowSum;
+    uint16_t calHighSum;
+    uint32_t gain;
+    while (!calButton);                 // Wait for release of the button held at reset
+    __delay_ms(50);                     // Debounce
+    GP2 = 1;                            // LED on, low point
+    calLowSum = calCapturePoint();
+    GP2 = 0;                            // LED off, high point
+    calHighSum = calCapturePoint();
+    if (calHighSum <= calLowSum)
+    {
+        calFail();                      // Points reversed or equal, keep existing calibration
+        return;
+    }
+    gain = ((uint32_t)(CALHIGHmV - CALLOWmV) << 16) / (calHighSum - calLowSum);
+    if (gain > 0xFFFF)
+    {
+        calFail();                      // Gain out of Q3 range, keep existing calibration
+        return;
+    }
+    ADCgain = (uint16_t)gain;
+    ADCoffset = 0;
+    ADCoffset = CALLOWmV - (int16_t)ADCtomV(calLowSum);  // Offset taken at the low point
+    eeprom_write(CALEEPROMADDR, (uint8_t)ADCgain);
+    eeprom_write(CALEEPROMADDR + 1, (uint8_t)(ADCgain >> 8));
+    eeprom_write(CALEEPROMADDR + 2, (uint8_t)ADCoffset);
+    eeprom_write(CALEEPROMADDR + 3, (uint8_t)((uint16_t)ADCoffset >> 8));
+    eeprom_write(CALEEPROMADDR + 4, CALVALIDMARKER);
 }
 
+//********************************************************************************************
+// calCapturePoint() displays readings until GP3 is pressed, then returns the sum of
+// CALSAMPLES conversions taken at the press, ie. a Q3 raw ADC value.
+//********************************************************************************************
 
-/*********************************************************************************************
- tm1637StopCondition()
- Send the stop condition
-*********************************************************************************************/
-void tm1637StopCondition() 
+uint16_t calCapturePoint(void)
 {
-    TRISIO &= ~(1<<tm1637dioTrisBit);   // Clear data tris bit
-    tm1637dio = 0;                      // Data low
-    __delay_us(100);
-    TRISIO |= 1<<tm1637clkTrisBit;      // Set tris to release clk
-    //tm1637clk = 1;
-    __delay_us(100);
-    // Release data
-    TRISIO |= 1<<tm1637dioTrisBit;      // Set tris to release data
-    __delay_us(100);
-}
-
-
-/*********************************************************************************************
- tm1637ByteWrite(char bWrite)
- Write one byte
-*********************************************************************************************/
-uint8_t tm1637ByteWrite(uint8_t bWrite) {
-    for (uint8_t i = 0; i < 8; i++) {
-        // Clock low
-        TRISIO &= ~(1<<tm1637clkTrisBit);   // Clear clk tris bit
-        tm1637clk = 0;
-        __delay_us(100);
-        
-        // Test bit of byte, data high or low:
-        if ((bWrite & 0x01) > 0) {
-            TRISIO |= 1<<tm1637dioTrisBit;      // Set data tris 
-        } else {
-            TRISIO &= ~(1<<tm1637dioTrisBit);   // Clear data tris bit
-            tm1637dio = 0;
+    uint16_t ADCsum;
+    do
+    {
+        ADCsum = 0;
+        for (uint8_t ctr = 0; ctr < CALSAMPLES; ctr++)
+        {
+            __delay_us(20);                 // Acquisition time before each conversion
+            ADCON0 |= 0x02;                 // Set GO/DONE, bit 1, to start conversion
+            while (ADCON0 & 0x02);          // Wait for conversion complete
+            ADCsum += readADCraw();
         }
-        __delay_us(100);
+        getDigits(ADCtomV(ADCsum));
+        tm1637UpdateDisplay();
+    } while (calButton);                    // Loop until button pressed
+    __delay_ms(50);
+    while (!calButton);                     // Wait for release
+    __delay_ms(50);
+    return(ADCsum);
+}
 
-        // Shift bits to the left:
-        bWrite = (bWrite >> 1);
-        TRISIO |= 1<<tm1637clkTrisBit;      // Set tris so clk goes high
-        __delay_us(100);
-    }
+//********************************************************************************************
+// calFail() shows a failed calibration: the display shows 0.00 and it blinks with the LED
+// until the operator acknowledges by pressing GP3, so a failure cannot go unnoticed.
+//********************************************************************************************
 
-    // Wait for ack, send clock low:
-    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit
-    tm1637clk = 0;
-    TRISIO |= 1<<tm1637dioTrisBit;         // Set data tris, makes input
-    tm1637dio = 0;
-    __delay_us(100);
-    
-    TRISIO |= 1<<tm1637clkTrisBit;         // Set tris so clk goes high
-    __delay_us(100);
-    uint8_t tm1637ack = tm1637dio;
-    if (!tm1637ack)
+void calFail(void)
+{
+    getDigits(0);
+    tm1637UpdateDisplay();
+    while (calButton)                       // Blink display and LED until button pressed
     {
-        TRISIO &= ~(1<<tm1637dioTrisBit);  // Clear data tris bit
-        tm1637dio = 0;
+        GP2 = 1;
+        tm1637DisplayOff();
+        __delay_ms(250);
+        GP2 = 0;
+        tm1637DisplayOn();
+        __delay_ms(250);
     }
-    __delay_us(100);
-    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit, set clock low
-    tm1637clk = 0;
-    __delay_us(100);
-
-    return 1;
+    __delay_ms(50);
+    while (!calButton);                     // Wait for release
+    __delay_ms(50);
 }
+#endif
 
 
 /*********************************************************************************************
@@ -370,13 +465,34 @@ uint8_t tm1637ByteWrite(uint8_t bWrite) {
 void initialise()
 {
     GPIO = 0b00000000;             // all pins low by default
+#if UARTTELEMETRY
+    uartTxPin = 1;                 // UART line idles high
+#endif
     TRISIO = trisConfiguration;    // All pins set as digital outputs other than GP 4/5(TM1637)
     TRISIO |= ADCinputConfig;      // Setting bit 0..3 sets digital i/o 0..3 to input(high impedance)
     CMCON = 7;                     // comparator off
+#if UARTTELEMETRY
+    OPTION_REG = 0b10000000;       // UART bit timing: Timer0 internal clock, prescaler to Timer0 at 1:2
+#endif                             // (bit 7 set also disables pullups)
     ANSEL = 0x10;                  // Init ADC with 8Tosc ADC conversion time
     ANSEL |= ADCinputConfig;       // Setup analogue inputs ANS3..0, bit 0..3 set enables each analogue input
     ADCON0 = 0x81;                 // ADC initialised for right justified data, ADC turned on (bit 0)
+#if ADCVREFEXTERNAL
+    TRISIO |= 0x02;                // GP1 is the VREF input
+    ANSEL |= 0x02;                 // ANS1 set so GP1 digital input buffer is off
+    ADCON0 |= 0x40;                // VCFG bit 6 set, Vref taken from GP1 instead of VDD
+#endif
     ADCON0 |= ADCchannel<<2;       // Set the active ADC channel, bits 2/3 CHS0 CHS1, 0 = AN0 ..3 = AN3
+    ADCgain = RefmV << ADCGAINFRACBITS;   // Uncalibrated gain from nominal Vref
+    ADCoffset = 0;
+#if ADCCALIBRATION
+    if (eeprom_read(CALEEPROMADDR + 4) == CALVALIDMARKER)  // Use stored calibration if present
+    {
+        ADCgain = eeprom_read(CALEEPROMADDR);
+        ADCgain |= (uint16_t)eeprom_read(CALEEPROMADDR + 1) << 8;
+        ADCoffset = (int16_t)(eeprom_read(CALEEPROMADDR + 2) | ((uint16_t)eeprom_read(CALEEPROMADDR + 3) << 8));
+    }
+#endif
     T1CON = 0;                     // Clear T1 control bits
     T1CON |= (T1PRESCALE<<4);      // Bits 4-5 set prescale, 01 = 1:2
     T1CON |= (T1CLK<<2);           // Bit 2 set enables disables external clock input 
@@ -388,36 +504,6 @@ void initialise()
 }
 
 
-/*************************************************************************************************
- getDigits extracts decimal digit numbers from an integer for the display, note max displayed value is 
- 9999 for 4 digit display, truncation of larger numbers. Larger displays: note maximum 65K as coded with 
- 16 bit parameter - probable need to declare number as uint32_t if coding for a 6 digit display  
- ************************************************************************************************/
-
-uint8_t getDigits(uint16_t number)
-{ 
-    int8_t ctr = (tm1637RightDigit);            // Start processing for the rightmost displayed digit
-    for (uint8_t ctr2 = 0; ctr2 < tm1637MaxDigits; ctr2++)
-    {
-        tm1637Data[ctr2]=0;      //Initialise the display data array with 0s
-    }
-    while(number > 0)            //Do if number greater than 0, ie. until all number's digits processed
-    {
-        if (ctr >= 0)
-        {
-           uint16_t modulus = number % 10;      // Split last digit from number
-           tm1637Data[ctr] = (uint8_t)modulus;  // Update display character array
-           number = number / 10;                // Divide number by 10
-           ctr --;                              // Decrement digit counter to process number from right to left
-        }
-        else
-        {
-           number = 0;                          // Stop processing if have exceeded display's no of digits
-        }
-    }
-    return 1;
-}
-
 //*****************************************************************************************
 // roundDigits applies decimal rounding to digit data stored in tm1637Data array
 // processing the digit data from right (least significant) to left. As written 
@@ -450,3 +536,151 @@ void roundDigits(void)
         }
     }
 }
+
+
+#if UARTTELEMETRY
+//*****************************************************************************************
+// uartQueueByte adds a byte to the transmit queue and enables the Timer0 interrupt if the
+// UART is idle. Non-blocking, if the queue is full the byte is dropped and counted.
+//*****************************************************************************************
+
+void uartQueueByte(uint8_t txByte)
+{
+    if ((uint8_t)(uartHead - uartTail) >= UARTBUFFERSIZE)  // Free running counts, so full = 8 queued
+    {
+        uartDropCount ++;
+        return;
+    }
+    uartBuffer[uartHead & UARTBUFFERMASK] = txByte;
+    uartHead ++;                     // Update head before checking the ISR has gone idle
+    if (!(INTCON & 0x20))            // Timer0 interrupt off, UART idle so restart it
+    {
+        TMR0 = UARTTMR0RELOAD;
+        INTCON &= 0xFB;              // Clear any stale Timer0 flag
+        INTCON |= 0x20;              // Timer0 interrupt enable bit 5
+    }
+}
+
+//*****************************************************************************************
+// uartSendFrame queues one 8 byte telemetry frame:
+// 0xA5, mV low, mV high, TM1637 NACK count, UART drop count, loop count low, loop count high,
+// checksum = low 8 bits of the sum of bytes 1..6. Loop count is then restarted.
+//*****************************************************************************************
+
+void uartSendFrame(uint16_t mV)
+{
+    uint8_t frame[6];
+    uint8_t checksum = 0;
+    frame[0] = (uint8_t)mV;
+    frame[1] = (uint8_t)(mV >> 8);
+    frame[2] = tm1637NackCount;
+    frame[3] = uartDropCount;
+    frame[4] = (uint8_t)loopCount;
+    frame[5] = (uint8_t)(loopCount >> 8);
+    loopCount = 0;
+    uartQueueByte(UARTFRAMESYNC);
+    for (uint8_t ctr = 0; ctr < 6; ctr++)
+    {
+        uartQueueByte(frame[ctr]);
+        checksum += frame[ctr];
+    }
+    uartQueueByte(checksum);
+}
+#endif
+
+
+#if ALARMENABLE
+//*****************************************************************************************
+// alarmSetLimits converts the mV thresholds to Q3 raw ADC values once gain and offset are
+// known, so each sub-sample is compared without a multiply. Each limit is the largest Q3
+// value that converts to no more than the given mV:
+//   mV > high             is  Q3 > alarmHighQ3
+//   mV < low              is  Q3 <= alarmLowQ3
+//   mV < high - hyst      is  Q3 <= alarmClearHighQ3
+//   mV > low + hyst       is  Q3 > alarmClearLowQ3
+//*****************************************************************************************
+
+void alarmSetLimits(void)
+{
+    alarmHighQ3 = alarmmVtoQ3(alarmHighmV);
+    alarmLowQ3 = alarmmVtoQ3(alarmLowmV - 1);
+    alarmClearHighQ3 = alarmmVtoQ3(alarmHighmV - alarmHysteresismV - 1);
+    alarmClearLowQ3 = alarmmVtoQ3(alarmLowmV + alarmHysteresismV);
+}
+
+//*****************************************************************************************
+// alarmmVtoQ3 finds the largest Q3 value that ADCtomV() converts to mV or less. A binary
+// search using ADCtomV() avoids pulling in the 32 bit divide, 13 bits covers 1023 x 8.
+//*****************************************************************************************
+
+uint16_t alarmmVtoQ3(uint16_t mV)
+{
+    uint16_t ADCvalQ3 = 0;
+    for (uint16_t bit = 0x1000; bit; bit >>= 1)
+    {
+        if (ADCtomV(ADCvalQ3 | bit) <= mV)
+            ADCvalQ3 |= bit;
+    }
+    return(ADCvalQ3);
+}
+
+//*****************************************************************************************
+// alarmCheck is called with every ADC sub-sample as a Q3 raw value. Outside the thresholds
+// it sets alarmCondition, alarmTick() then trips the alarm once this persists. An active
+// alarm only clears once the value is back inside both thresholds by the hysteresis margin.
+//*****************************************************************************************
+
+void alarmCheck(uint16_t ADCvalQ3)
+{
+    if (!alarmActive)
+    {
+        alarmCondition = (ADCvalQ3 > alarmHighQ3) || (ADCvalQ3 <= alarmLowQ3);
+    }
+    else if ((ADCvalQ3 <= alarmClearHighQ3) && (ADCvalQ3 > alarmClearLowQ3))
+    {
+        alarmActive = 0;
+        alarmCondition = 0;
+        alarmTripCounter = 0;
+        alarmPin = 0;
+        if (alarmDisplayOff)
+        {
+            tm1637DisplayOn();              // Single command byte restores the display
+            alarmDisplayOff = 0;
+        }
+    }
+}
+
+//*****************************************************************************************
+// alarmTick is called every 100ms Timer1 tick. Times the trip delay and, when active, blinks
+// the display using the display on/off commands rather than rewriting the digit data.
+//*****************************************************************************************
+
+void alarmTick(void)
+{
+    if (alarmActive)
+    {
+        alarmBlinkCounter ++;
+        if (alarmBlinkCounter >= ALARMBLINKTICKS)
+        {
+            alarmBlinkCounter = 0;
+            alarmDisplayOff = !alarmDisplayOff;
+            if (alarmDisplayOff)
+                tm1637DisplayOff();
+            else
+                tm1637DisplayOn();
+        }
+    }
+    else if (alarmCondition)
+    {
+        alarmTripCounter ++;
+        if (alarmTripCounter >= ALARMTRIPTICKS)
+        {
+            alarmActive = 1;
+            alarmPin = 1;                   // Alarm output on
+            alarmBlinkCounter = 0;
+        }
+    }
+    else
+        alarmTripCounter = 0;
+}
+#endif
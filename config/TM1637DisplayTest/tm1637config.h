@@ -0,0 +1,19 @@
+// ---------------------------------------------------------------------
+// Build configuration for the TM1637DisplayTest.c image, included by tm1637.h so that
+// the main file and tm1637.c always see the same settings. Add this directory to the
+// MPLAB X project include path (XC8 compiler, include directories).
+// -----------------------------------------------------------------------
+
+#ifndef TM1637CONFIG_H
+#define TM1637CONFIG_H
+
+#define _XTAL_FREQ 4000000            // Define clock frequency used by xc8 __delay(time) functions
+
+// TM1637 driver features, 1 = included, see tm1637.h:
+#define TM1637_ZEROBLANKING 1         // Count is displayed with leading zeros blanked
+#define TM1637_DECIMALPOINT 0
+#define TM1637_DIGITLIMIT 0
+#define TM1637_KEYSCAN 0
+#define TM1637_ACKCHECK 0
+
+#endif // TM1637CONFIG_H
@@ -0,0 +1,272 @@
+// ---------------------------------------------------------------------
+// TM1637 display driver for the PIC 12F675, see tm1637.h for the compile time
+// feature options. The TM1637 routines were originally written by electro-dan for
+// the BoostC compiler and adapted by Steve Williams for the MPLAB XC8 compiler.
+// No warranty is implied and the code is for test use at users own risk. 
+// -----------------------------------------------------------------------
+
+
+#include "tm1637.h"
+
+//Display variables:
+const uint8_t tm1637ByteSetData = 0x40;        // 0x40 [01000000] = Indicate command to display data
+const uint8_t tm1637ByteSetAddr = 0xC0;        // 0xC0 [11000000] = Start address write out all display bytes 
+const uint8_t tm1637ByteSetOn = 0x88;          // 0x88 [10001000] = Display ON, plus brightness
+const uint8_t tm1637ByteSetOff = 0x80;         // 0x80 [10000000] = Display OFF 
+#if TM1637_KEYSCAN
+const uint8_t tm1637ByteReadKeys = 0x42;       // 0x42 [01000010] = Read key scan data
+#endif
+// Used to output the segment data for numbers 0..9 :
+const uint8_t tm1637DisplayNumtoSeg[] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+uint8_t tm1637Brightness = 5;         // Range 0 to 7
+uint8_t tm1637Data[] = {0, 0, 0, 0};  // Digit numeric data to display,array elements are for digits 0..3
+#if TM1637_DECIMALPOINT
+uint8_t decimalPointPos = 99;         // Flag for decimal point (digits counted from left),if > MaxDigits dp off
+#endif
+#if TM1637_ZEROBLANKING
+uint8_t zeroBlanking = 1;             // If set true blanks leading zeros
+#endif
+#if TM1637_DIGITLIMIT
+uint8_t numDisplayedDigits = tm1637MaxDigits; // Limits total displayed digits, used after rounding a decimal value
+#endif
+#if TM1637_ACKCHECK
+uint8_t tm1637NackCount = 0;          // TM1637 bytes written with no ACK from the display
+#endif
+
+
+/*********************************************************************************************
+ tm1637UpdateDisplay()
+ Publish the tm1637Data array to the display
+*********************************************************************************************/
+void tm1637UpdateDisplay()
+{   
+    uint8_t tm1637DigitSegs = 0;
+    uint8_t ctr;
+#if TM1637_ZEROBLANKING
+    uint8_t stopBlanking = !zeroBlanking;            // Allow blanking of leading zeros if flag set
+#endif
+            
+    // Write 0x40 [01000000] to indicate command to display data - [Write data to display register]:
+    tm1637StartCondition();
+    tm1637ByteWrite(tm1637ByteSetData);
+    tm1637StopCondition();
+
+    // Specify the display address 0xC0 [11000000] then write out all 4 bytes:
+    tm1637StartCondition();
+    tm1637ByteWrite(tm1637ByteSetAddr);
+    for (ctr = 0; ctr < tm1637MaxDigits; ctr ++)
+    {
+        tm1637DigitSegs = tm1637DisplayNumtoSeg[tm1637Data[ctr]];
+#if TM1637_ZEROBLANKING
+        if (!stopBlanking && (tm1637Data[ctr]==0))  // Blank leading zeros if stop blanking flag not set
+            {
+               if (ctr < tm1637RightDigit)          // Never blank the rightmost digit
+                  tm1637DigitSegs = 0;              // Segments set 0x00 gives blanked display numeral
+            }
+        else
+#endif
+        {
+#if TM1637_ZEROBLANKING
+           stopBlanking = 1;                    // Stop blanking if have reached a non-zero digit
+#endif
+#if TM1637_DECIMALPOINT
+           if (ctr==decimalPointPos)            // Flag for presence of decimal point, digits 0..3
+           {                                    // No dp display if decimalPointPos is set > Maxdigits
+               tm1637DigitSegs |= 0b10000000;   // High bit of segment data is decimal point, set to display
+           }
+#endif
+        }
+#if TM1637_DIGITLIMIT
+        if (ctr>(numDisplayedDigits-1))
+            tm1637DigitSegs = 0;             // Segments set 0x00 blanks,limits displayed digits left to right
+#endif
+        
+        tm1637ByteWrite(tm1637DigitSegs);       // Finally write out the segment data for each digit
+    }
+    tm1637StopCondition();
+
+    // Write 0x80 [10001000] - Display ON, plus brightness
+    tm1637StartCondition();
+    tm1637ByteWrite((tm1637ByteSetOn + tm1637Brightness));
+    tm1637StopCondition();
+}
+
+
+/*********************************************************************************************
+ tm1637DisplayOn()
+ Send display on command
+*********************************************************************************************/
+void tm1637DisplayOn(void)
+{
+    tm1637StartCondition();
+    tm1637ByteWrite((tm1637ByteSetOn + tm1637Brightness));
+    tm1637StopCondition();
+}
+
+
+/*********************************************************************************************
+ tm1637DisplayOff()
+ Send display off command
+*********************************************************************************************/
+void tm1637DisplayOff(void)
+{
+    tm1637StartCondition();
+    tm1637ByteWrite(tm1637ByteSetOff);
+    tm1637StopCondition();
+}
+
+/*********************************************************************************************
+ tm1637StartCondition()
+ Send the start condition
+*********************************************************************************************/
+void tm1637StartCondition(void) 
+{
+    TRISIO &= ~(1<<tm1637dioTrisBit);  //Clear data tris bit
+    tm1637dio = 0;                     //Data output set low
+    __delay_us(100);
+}
+
+
+/*********************************************************************************************
+ tm1637StopCondition()
+ Send the stop condition
+*********************************************************************************************/
+void tm1637StopCondition() 
+{
+    TRISIO &= ~(1<<tm1637dioTrisBit);   // Clear data tris bit
+    tm1637dio = 0;                      // Data low
+    __delay_us(100);
+    TRISIO |= 1<<tm1637clkTrisBit;      // Set tris to release clk
+    //tm1637clk = 1;
+    __delay_us(100);
+    // Release data
+    TRISIO |= 1<<tm1637dioTrisBit;      // Set tris to release data
+    __delay_us(100);
+}
+
+
+/*********************************************************************************************
+ tm1637ByteWrite(char bWrite)
+ Write one byte. Returns 1, or with TM1637_ACKCHECK returns 0 and counts a NACK if the
+ display did not acknowledge.
+*********************************************************************************************/
+uint8_t tm1637ByteWrite(uint8_t bWrite) {
+    for (uint8_t i = 0; i < 8; i++) {
+        // Clock low
+        TRISIO &= ~(1<<tm1637clkTrisBit);   // Clear clk tris bit
+        tm1637clk = 0;
+        __delay_us(100);
+        
+        // Test bit of byte, data high or low:
+        if ((bWrite & 0x01) > 0) {
+            TRISIO |= 1<<tm1637dioTrisBit;      // Set data tris 
+        } else {
+            TRISIO &= ~(1<<tm1637dioTrisBit);   // Clear data tris bit
+            tm1637dio = 0;
+        }
+        __delay_us(100);
+
+        // Shift bits to the left:
+        bWrite = (bWrite >> 1);
+        TRISIO |= 1<<tm1637clkTrisBit;      // Set tris so clk goes high
+        __delay_us(100);
+    }
+
+    // Wait for ack, send clock low:
+    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit
+    tm1637clk = 0;
+    TRISIO |= 1<<tm1637dioTrisBit;         // Set data tris, makes input
+    tm1637dio = 0;
+    __delay_us(100);
+    
+    TRISIO |= 1<<tm1637clkTrisBit;         // Set tris so clk goes high
+    __delay_us(100);
+    uint8_t tm1637ack = tm1637dio;
+    if (!tm1637ack)
+    {
+        TRISIO &= ~(1<<tm1637dioTrisBit);  // Clear data tris bit
+        tm1637dio = 0;
+    }
+    __delay_us(100);
+    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit, set clock low
+    tm1637clk = 0;
+    __delay_us(100);
+
+#if TM1637_ACKCHECK
+    if (tm1637ack)                         // Display did not pull data low
+    {
+        tm1637NackCount ++;
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+
+#if TM1637_KEYSCAN
+/*********************************************************************************************
+ tm1637ReadKeys()
+ Send the read keys command then clock in the key scan byte, LSB first. The TM1637
+ returns 0xFF if no key is pressed.
+*********************************************************************************************/
+uint8_t tm1637ReadKeys(void)
+{
+    uint8_t keys = 0;
+    tm1637StartCondition();
+    tm1637ByteWrite(tm1637ByteReadKeys);
+    TRISIO |= 1<<tm1637dioTrisBit;         // Release data, TM1637 now drives it
+    for (uint8_t i = 0; i < 8; i++) {
+        keys = (keys >> 1);
+        TRISIO &= ~(1<<tm1637clkTrisBit);   // Clear clk tris bit, clock low
+        tm1637clk = 0;
+        __delay_us(100);
+        TRISIO |= 1<<tm1637clkTrisBit;      // Set tris so clk goes high, data valid
+        __delay_us(100);
+        if (tm1637dio)
+            keys |= 0x80;
+    }
+
+    // Clock the ack bit:
+    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit
+    tm1637clk = 0;
+    __delay_us(100);
+    TRISIO |= 1<<tm1637clkTrisBit;         // Set tris so clk goes high
+    __delay_us(100);
+    TRISIO &= ~(1<<tm1637clkTrisBit);      // Clear clk tris bit, set clock low
+    tm1637clk = 0;
+    __delay_us(100);
+    tm1637StopCondition();
+    return keys;
+}
+#endif
+
+
+/*************************************************************************************************
+ getDigits extracts decimal digit numbers from an integer for the display, note max displayed value is 
+ 9999 for 4 digit display, truncation of larger numbers. Larger displays: note maximum 65K as coded with 
+ 16 bit parameter - probable need to declare number as uint32_t if coding for a 6 digit display  
+ ************************************************************************************************/
+
+uint8_t getDigits(uint16_t number)
+{ 
+    int8_t ctr = (tm1637RightDigit);            // Start processing for the rightmost displayed digit
+    for (uint8_t ctr2 = 0; ctr2 < tm1637MaxDigits; ctr2++)
+    {
+        tm1637Data[ctr2]=0;      //Initialise the display data array with 0s
+    }
+    while(number > 0)            //Do if number greater than 0, ie. until all number's digits processed
+    {
+        if (ctr >= 0)
+        {
+           uint16_t modulus = number % 10;      // Split last digit from number
+           tm1637Data[ctr] = (uint8_t)modulus;  // Update display character array
+           number = number / 10;                // Divide number by 10
+           ctr --;                              // Decrement digit counter to process number from right to left
+        }
+        else
+        {
+           number = 0;                          // Stop processing if have exceeded display's no of digits
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,83 @@
+// ---------------------------------------------------------------------
+// TM1637 display driver for the PIC 12F675, shared by TM1637DisplayTest.c and 
+// TM1637ADC.c. The TM1637 routines were originally written by electro-dan for the 
+// BoostC compiler as part of project: 
+// https://github.com/electro-dan/PIC12F_TM1637_Thermometer
+// 
+// Driver features are selected at compile time so that unused code is not compiled.
+// Each image has its own tm1637config.h, in config/<image name>/ which must be on the
+// project include path, so that tm1637.c and the main file see the same values. The
+// clock frequency _XTAL_FREQ is also set there. Features, 1 = included:
+// TM1637_ZEROBLANKING  zeroBlanking flag, blanks leading zeros      (default 1)
+// TM1637_DECIMALPOINT  decimalPointPos sets a decimal point         (default 0)
+// TM1637_DIGITLIMIT    numDisplayedDigits limits displayed digits   (default 0)
+// TM1637_KEYSCAN       tm1637ReadKeys() reads the key scan data     (default 0)
+// TM1637_ACKCHECK      tm1637ByteWrite() returns ACK, NACKs counted (default 0)
+// -----------------------------------------------------------------------
+
+#ifndef TM1637_H
+#define TM1637_H
+
+#include <xc.h>
+#include "tm1637config.h"             // Per image settings, from config/<image name>/
+
+#ifndef _XTAL_FREQ
+#error "_XTAL_FREQ must be set in tm1637config.h, the driver __delay_us() timing depends on it"
+#endif
+
+#ifndef TM1637_ZEROBLANKING
+#define TM1637_ZEROBLANKING 1
+#endif
+#ifndef TM1637_DECIMALPOINT
+#define TM1637_DECIMALPOINT 0
+#endif
+#ifndef TM1637_DIGITLIMIT
+#define TM1637_DIGITLIMIT 0
+#endif
+#ifndef TM1637_KEYSCAN
+#define TM1637_KEYSCAN 0
+#endif
+#ifndef TM1637_ACKCHECK
+#define TM1637_ACKCHECK 0
+#endif
+
+// Set the TM1637 module data and clock pins:
+#define trisConfiguration 0b00110000; // TM1637 GP4/5 pins are inputs, TM1637 module pullups 
+                                      // will take these high. Configuration here of display pins ONLY 
+#define tm1637dio GP4                 // Set the i/o ports names for TM1637 data and clock here
+#define tm1637dioTrisBit 4            // This is the bit shift to set TRIS for GP4
+#define tm1637clk GP5
+#define tm1637clkTrisBit 5
+
+#define tm1637MaxDigits 4
+#define tm1637RightDigit (tm1637MaxDigits - 1)
+
+//Display variables:
+extern uint8_t tm1637Brightness;          // Range 0 to 7
+extern uint8_t tm1637Data[tm1637MaxDigits]; // Digit numeric data to display,array elements are for digits 0..3
+#if TM1637_DECIMALPOINT
+extern uint8_t decimalPointPos;           // Flag for decimal point (digits counted from left),if > MaxDigits dp off
+#endif
+#if TM1637_ZEROBLANKING
+extern uint8_t zeroBlanking;              // If set true blanks leading zeros
+#endif
+#if TM1637_DIGITLIMIT
+extern uint8_t numDisplayedDigits;        // Limits total displayed digits, used after rounding a decimal value
+#endif
+#if TM1637_ACKCHECK
+extern uint8_t tm1637NackCount;           // TM1637 bytes written with no ACK from the display
+#endif
+
+//Function prototypes:
+void tm1637StartCondition(void);
+void tm1637StopCondition(void);
+uint8_t tm1637ByteWrite(uint8_t bWrite);
+void tm1637UpdateDisplay(void);
+void tm1637DisplayOn(void);
+void tm1637DisplayOff(void);
+uint8_t getDigits(uint16_t number);       //Extracts decimal digits from integer, populates tm1637Data array
+#if TM1637_KEYSCAN
+uint8_t tm1637ReadKeys(void);             // Returns key scan byte, 0xFF if no key pressed
+#endif
+
+#endif // TM1637_H